@@ -1,3 +1,6 @@
+#pragma once
+
+#include <cstddef>
 #include <cstdint>
 
 using u8 = std::uint8_t;
@@ -10,12 +13,13 @@ const int REGISTER_COUNT = 16; // Number of V registers
 const int GFX_HEIGHT = 32; // Graphics buffer, height
 const int GFX_WIDTH = 64; // Graphics buffer, width
 const int KEY_COUNT = 16; // Number of keys for keypad
+const int CYCLES_PER_FRAME = 13; // Instructions per 60Hz frame (~1.3ms per instruction)
 
 
 struct Chip8 {
     // Using member initializer list with the Chip8 constructor instead of
     // using the Chip8::init() function
-    Chip8() : pc(0x200), sp(0), opcode(0), I(0) {}
+    Chip8() : pc(0x200), sp(0), opcode(0), I(0), rng(1) {}
 
     // Chip-8 Specs
 
@@ -35,11 +39,21 @@ struct Chip8 {
     u8 keypad[KEY_COUNT];   // Keypad
     u8 gfx[GFX_WIDTH * GFX_HEIGHT]; // Graphics Buffer, total size = 2048 bytes (64*32)
     bool drawFlag;
+    u16 keyReadMask; // Bit i is set when the ROM reads key i (Ex9E, ExA1 read one key, Fx0A all of them)
+    bool fault; // Set when execution hits an invalid opcode, stack over/underflow or runs off memory
+
+    u32 rng; // xorshift32 state for Cxkk, kept per machine so snapshots replay exactly
 
     // Chip-8 Functions
     void init(); // Function to initialize
 
+    void seed(u32 value); // Seed the random number generator
+
+    u8 random_byte();
+
     void execute_cycle();
 
     bool load_rom(const char *rom_path);
+
+    bool load_rom(const u8 *rom_data, size_t size);
 };
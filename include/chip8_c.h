@@ -0,0 +1,97 @@
+#ifndef CHIP8_C_H
+#define CHIP8_C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Plain C interface to the Chip-8 core, built as libchip8. Every function is
+ * safe to call from any language with a C FFI. Pointers returned by
+ * chip8_get_view() alias the machine directly (no copies) and stay valid
+ * until chip8_destroy() is called on that machine.
+ *
+ * Machine, machine array and view arguments must not be NULL; only
+ * chip8_destroy(NULL) is allowed. ROM and snapshot buffers may be NULL, in
+ * which case the call returns -1. */
+
+/* CHIP8_BUILD is defined only while building libchip8 itself */
+#if defined(_WIN32) && defined(CHIP8_BUILD)
+#define CHIP8_API __declspec(dllexport)
+#elif defined(_WIN32)
+#define CHIP8_API __declspec(dllimport)
+#else
+#define CHIP8_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CHIP8_GFX_WIDTH 64
+#define CHIP8_GFX_HEIGHT 32
+#define CHIP8_KEY_COUNT 16
+#define CHIP8_REGISTER_COUNT 16
+
+/* main.cpp runs one instruction every 1.3ms, which is ~13 instructions per 60Hz frame */
+#define CHIP8_CYCLES_PER_FRAME 13
+
+typedef struct chip8_t chip8_t; /* Opaque handle to one machine */
+
+/* Read-only view into a machine's state, filled by chip8_get_view() */
+typedef struct chip8_view {
+    const uint8_t *gfx;         /* CHIP8_GFX_WIDTH * CHIP8_GFX_HEIGHT bytes, one per pixel (0 or 1) */
+    const uint8_t *V;           /* CHIP8_REGISTER_COUNT bytes, V0-VF */
+    const uint16_t *I;          /* Index register */
+    const uint16_t *pc;         /* Program counter */
+    const uint8_t *sp;          /* Stack pointer */
+    const uint16_t *stack;      /* 16 entries */
+    const uint8_t *delay_timer; /* Delay timer */
+    const uint8_t *sound_timer; /* Sound timer */
+    const uint8_t *memory;      /* 4096 bytes of system memory */
+    const uint8_t *keypad;      /* CHIP8_KEY_COUNT bytes */
+    const uint8_t *draw_flag;   /* Non-zero once the framebuffer changed, cleared by chip8_clear_draw_flag() */
+    const uint16_t *opcode;     /* Last fetched opcode, the faulting one once fault is set */
+    const uint8_t *fault;       /* Non-zero once the machine halted on a bad opcode or state */
+} chip8_view;
+
+/* Lifetime. Each machine has its own random number generator (used by Cxkk),
+ * so machines never share random state and the same seed replays the same run. */
+CHIP8_API chip8_t *chip8_create(uint32_t seed);
+CHIP8_API void chip8_destroy(chip8_t *machine);
+CHIP8_API void chip8_seed(chip8_t *machine, uint32_t seed);
+
+/* Reset the machine and copy a ROM into memory at 0x200. Returns 0 on success.
+ * Returns -1 and leaves the machine untouched if rom is NULL or size is over
+ * 3584 bytes. The random number generator is left as is; call chip8_seed() to
+ * restart it. */
+CHIP8_API int chip8_load_rom(chip8_t *machine, const uint8_t *rom, size_t size);
+
+/* Execution. Returns 0, or -1 once the machine has faulted (invalid opcode, stack
+ * over/underflow, PC off the end of memory). A faulted machine stays halted until
+ * chip8_load_rom() or chip8_load_state(); the opcode is in chip8_view.opcode. */
+CHIP8_API int chip8_step(chip8_t *machine, int cycles);
+CHIP8_API int chip8_step_frame(chip8_t *machine);
+
+/* Step every machine in the array by the same number of cycles in one call.
+ * Returns how many of the machines are faulted. */
+CHIP8_API size_t chip8_step_batch(chip8_t *const *machines, size_t count, int cycles);
+CHIP8_API size_t chip8_step_frame_batch(chip8_t *const *machines, size_t count);
+
+/* Input: bit i of the mask is key i of the keypad */
+CHIP8_API void chip8_set_keypad(chip8_t *machine, uint16_t mask);
+
+/* Zero-copy state access */
+CHIP8_API void chip8_get_view(const chip8_t *machine, chip8_view *view);
+CHIP8_API void chip8_clear_draw_flag(chip8_t *machine);
+
+/* Snapshots. The buffer must hold chip8_state_size() bytes. Returns 0 on success.
+ * chip8_load_state() returns -1 and leaves the machine untouched if the snapshot
+ * has an out-of-range PC, stack pointer or I, or a corrupt flag byte. */
+CHIP8_API size_t chip8_state_size(void);
+CHIP8_API int chip8_save_state(const chip8_t *machine, void *buffer, size_t size);
+CHIP8_API int chip8_load_state(chip8_t *machine, const void *buffer, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CHIP8_C_H
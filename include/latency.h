@@ -0,0 +1,41 @@
+#pragma once
+
+#include <chrono>
+#include <vector>
+
+#include "chip8.h"
+
+using latency_clock = std::chrono::steady_clock;
+
+// Follows every keypad event through the emulator:
+// key event -> ROM reads that key (Ex9E/ExA1/Fx0A) -> next draw (CLS/Dxyn) -> next present
+struct LatencyTracker {
+    void key_event(int key, latency_clock::time_point when); // Keydown or keyup of keypad key
+    void key_read(u16 keys, latency_clock::time_point when); // ROM read the keys in the mask
+    void draw(latency_clock::time_point when);               // ROM changed the framebuffer
+    void present(latency_clock::time_point when);            // Frame was handed to the renderer
+
+    void report() const; // Print latency percentiles for every completed trace
+
+private:
+    struct Trace {
+        int key = 0;
+        latency_clock::time_point event;
+        latency_clock::time_point read;
+        latency_clock::time_point drawn;
+        bool was_read = false;
+        bool was_drawn = false;
+    };
+
+    std::vector<Trace> pending; // Events that have not been presented yet
+
+    // Completed stage timings, in microseconds
+    std::vector<double> event_to_read;
+    std::vector<double> read_to_draw;
+    std::vector<double> draw_to_present;
+    std::vector<double> event_to_present;
+
+    // Events evicted because the pending list filled up, split by whether the ROM had read them
+    u32 dropped_unread = 0;
+    u32 dropped_read = 0;
+};
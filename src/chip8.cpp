@@ -1,5 +1,3 @@
-#include <chrono>
-
 #include "../include/chip8.h"
 
 #include "fmt/core.h"
@@ -8,6 +6,13 @@
 #define Vx V[(opcode & 0x0F00) >> 8]
 #define Vy V[(opcode & 0x00F0) >> 4]
 
+// Per-instruction trace, only compiled into builds that define CHIP8_TRACE
+#ifdef CHIP8_TRACE
+#define TRACE(...) fmt::print(__VA_ARGS__)
+#else
+#define TRACE(...)
+#endif
+
 
 /* Key:
 nnn or addr - A 12-bit value, the lowest 12 bits of the instruction
@@ -75,6 +80,16 @@ static u8 font_set[FONT_SIZE]{
 
 void Chip8::init() {
 
+    // Reset CPU state so a machine can be reloaded with a new ROM
+
+    pc = 0x200;
+    sp = 0;
+    I = 0;
+    opcode = 0;
+    drawFlag = false;
+    keyReadMask = 0;
+    fault = false;
+
     // Clear Memory
 
     for (u8 &i : memory) {
@@ -103,15 +118,34 @@ void Chip8::init() {
 
     delay_timer = 0;
     sound_timer = 0;
+}
+
+void Chip8::seed(u32 value) {
+    // xorshift never leaves the all-zero state, so avoid it
+    rng = value != 0 ? value : 1;
+}
 
-    // Generate a random seed based on current time
-    auto seed = std::chrono::system_clock::now().time_since_epoch().count();
-    srand(seed);
+// Marsaglia's xorshift32, cheap and fully described by one u32 of state
+u8 Chip8::random_byte() {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng >> 24;
 }
 
 // In order to emulate the Chip-8 on a cycle-level, we have to use the
 // fetch-decode-execute process.
+// A faulted machine stays halted until it is re-initialized.
 void Chip8::execute_cycle() {
+    if (fault) {
+        return;
+    }
+    // The program counter has run off the end of memory
+    if (pc > SYSTEM_MEMORY - 2) {
+        fault = true;
+        return;
+    }
+
     opcode = memory[pc] << 8 | memory[pc + 1]; // Fetch next instruction
 
     switch (opcode & 0xF000) {
@@ -120,7 +154,7 @@ void Chip8::execute_cycle() {
             switch (opcode & 0x000F) {
                 // Clear display
                 case Opcode00E0:
-                    fmt::print("Current Instruction: CLS\n");
+                    TRACE("Current Instruction: CLS\n");
                     for (u8 &i : gfx) {
                         i = 0;
                     }
@@ -130,33 +164,42 @@ void Chip8::execute_cycle() {
                     break;
                     // Return from subroutine
                 case Opcode00EE:
-                    fmt::print("Current Instruction: RET\n");
+                    TRACE("Current Instruction: RET\n");
+                    // Stack underflow
+                    if (sp == 0) {
+                        fault = true;
+                        return;
+                    }
                     --sp;
                     pc = stack[sp];
                     pc += 2;
                     break;
                 default:
-                    fmt::format("[ERROR]: Invalid opcode. Segment 0000. Draw-screen error. "
-                                "Opcode: {}\n",
-                                opcode);
-                    exit(EXIT_FAILURE);
+                    // Invalid opcode. Segment 0000
+                    fault = true;
+                    return;
             }
             break;
             // Jump to location nnn
         case Opcode1nnn:
-            fmt::print("Current Instruction: JP\n");
+            TRACE("Current Instruction: JP\n");
             pc = opcode & 0x0FFF;
             break;
             // Call subroutine at nnn
         case Opcode2nnn:
-            fmt::print("Current Instruction: CALL\n");
+            TRACE("Current Instruction: CALL\n");
+            // Stack overflow
+            if (sp == STACK_SIZE) {
+                fault = true;
+                return;
+            }
             stack[sp] = pc;
             sp++;
             pc = opcode & 0x0FFF;
             break;
             // Skip next instruction if Vx == kk
         case Opcode3xkk:
-            fmt::print("Current Instruction: SE Vx, byte\n");
+            TRACE("Current Instruction: SE Vx, byte\n");
             if (Vx == (opcode & 0x00FF)) {
                 pc += 4;
             } else {
@@ -165,7 +208,7 @@ void Chip8::execute_cycle() {
             break;
             // Skip next instruction if Vx != kk
         case Opcode4xkk:
-            fmt::print("Current Instruction: SNE Vx, byte\n");
+            TRACE("Current Instruction: SNE Vx, byte\n");
             if (Vx != (opcode & 0x00FF)) {
                 pc += 4;
             } else {
@@ -174,7 +217,7 @@ void Chip8::execute_cycle() {
             break;
             // Skip next instruction if Vx == Vy
         case Opcode5xy0:
-            fmt::print("Current Instruction: SE Vx, Vy\n");
+            TRACE("Current Instruction: SE Vx, Vy\n");
             if (Vx == Vy) {
                 pc += 4;
             } else {
@@ -183,13 +226,13 @@ void Chip8::execute_cycle() {
             }
             // Set Vx = kk
         case Opcode6xkk:
-            fmt::print("Current Instruction: LD Vx, byte\n");
+            TRACE("Current Instruction: LD Vx, byte\n");
             Vx = (opcode & 0x00FF);
             pc += 2;
             break;
             // Set Vx += kk
         case Opcode7xkk:
-            fmt::print("Current Instruction: ADD Vx, byte\n");
+            TRACE("Current Instruction: ADD Vx, byte\n");
             Vx += (opcode & 0x00FF);
             pc += 2;
             break;
@@ -197,32 +240,32 @@ void Chip8::execute_cycle() {
             switch (opcode & 0x000F) {
                 // Set Vx = Vy
                 case Opcode8xy0:
-                    fmt::print("Current Instruction: LD Vx, Vy\n");
+                    TRACE("Current Instruction: LD Vx, Vy\n");
                     Vx = Vy;
                     pc += 2;
                     break;
                     // Set Vx |= Vy
                 case Opcode8xy1:
-                    fmt::print("Current Instruction: OR Vx, Vy\n");
+                    TRACE("Current Instruction: OR Vx, Vy\n");
                     Vx |= Vy;
                     pc += 2;
                     break;
                     // Set Vx &= Vy
                 case Opcode8xy2:
-                    fmt::print("Current Instruction: AND Vx, Vy\n");
+                    TRACE("Current Instruction: AND Vx, Vy\n");
                     Vx &= Vy;
                     pc += 2;
                     break;
                     // Set Vx ^= Vy
                 case Opcode8xy3:
-                    fmt::print("Current Instruction: XOR Vx, Vy\n");
+                    TRACE("Current Instruction: XOR Vx, Vy\n");
                     Vx ^= Vy;
                     pc += 2;
                     break;
                     // Set Vx = Vx + Vy, set VF = carry if Vy > (0xF
                     // - Vx)
                 case Opcode8xy4:
-                    fmt::print("Current Instruction: ADD Vx, Vy\n");
+                    TRACE("Current Instruction: ADD Vx, Vy\n");
                     Vx += Vy;
                     if (Vy > (0x00FF - Vx)) {
                         V[0xF] = 1;
@@ -233,7 +276,7 @@ void Chip8::execute_cycle() {
                     break;
                     // Set Vx = Vx - Vy, set VF = NOT borrow
                 case Opcode8xy5:
-                    fmt::print("Current Instruction: SUB Vx, Vy\n");
+                    TRACE("Current Instruction: SUB Vx, Vy\n");
                     if (Vx > Vy) {
                         V[0xF] = 1;
                     } else {
@@ -244,14 +287,14 @@ void Chip8::execute_cycle() {
                     break;
                     // Set Vx = Vx SHR 1
                 case Opcode8xy6:
-                    fmt::print("Current Instruction: SHR Vx\n");
+                    TRACE("Current Instruction: SHR Vx\n");
                     V[0xF] = Vx & 0x0001;
                     Vx >>= 1;
                     pc += 2;
                     break;
                     // Set Vx = Vy - Vx, set VF = NOT borrow.
                 case Opcode8xy7:
-                    fmt::print("Current Instruction: SUBN Vx, Vy\n");
+                    TRACE("Current Instruction: SUBN Vx, Vy\n");
                     if (Vy > Vx) {
                         V[0xF] = 1;
                     } else {
@@ -262,18 +305,20 @@ void Chip8::execute_cycle() {
                     break;
                     // Set Vx = Vx SHL 1
                 case Opcode8xyE:
-                    fmt::print("Current Instruction: SHL Vx\n");
+                    TRACE("Current Instruction: SHL Vx\n");
                     V[0xF] = Vx >> 7;
                     Vx <<= 1;
                     pc += 2;
                     break;
                 default:
-                    fmt::format("[ERROR]: Invalid opcode Segment 8000. Opcode: {}\n", opcode);
+                    // Invalid opcode. Segment 8000
+                    fault = true;
+                    return;
             }
             break;
             // Skip next instruction if Vx != Vy
         case Opcode9xy0:
-            fmt::print("Current Instruction: SNE Vx, Vy\n");
+            TRACE("Current Instruction: SNE Vx, Vy\n");
             if (Vx != Vy) {
                 pc += 4;
             } else {
@@ -282,26 +327,26 @@ void Chip8::execute_cycle() {
             break;
             // Set I = nnn
         case OpcodeAnnn:
-            fmt::print("Current Instruction: LD I, addr\n");
+            TRACE("Current Instruction: LD I, addr\n");
             I = opcode & 0x0FFF;
             pc += 2;
             break;
             // Jump to location nnn + V0
         case OpcodeBnnn:
-            fmt::print("Current Instruction: JP V0, addr\n");
+            TRACE("Current Instruction: JP V0, addr\n");
             pc = (opcode & 0x0FFF) + V[0];
             pc += 2;
             break;
             // Set Vx = random byte AND kk
         case OpcodeCxkk:
-            fmt::print("Current Instruction: RND Vx, byte\n");
-            Vx = (rand() % 256) & (opcode & 0x00FF);
+            TRACE("Current Instruction: RND Vx, byte\n");
+            Vx = random_byte() & (opcode & 0x00FF);
             pc += 2;
             break;
             // Display n-byte sprite starting at memory location I at (Vx, Vy), set
             // VF = collision
         case OpcodeDxyn: {
-            fmt::print("Current Instruction: DRW Vx, Vy\n");
+            TRACE("Current Instruction: DRW Vx, Vy\n");
             u16 x = Vx;
             u16 y = Vy;
             u16 height = opcode & 0x000F;
@@ -309,13 +354,15 @@ void Chip8::execute_cycle() {
 
             V[0xF] = 0;
             for (int yline = 0; yline < height; yline++) {
-                pixel = memory[I + yline];
+                pixel = memory[(I + yline) & 0xFFF];
                 for (int xline = 0; xline < 8; xline++) {
                     if ((pixel & (0x80 >> xline)) != 0) {
-                        if (gfx[(x + xline + ((y + yline) * 64))] == 1) {
+                        // Sprites wrap around the edges of the screen
+                        int index = (x + xline) % GFX_WIDTH + ((y + yline) % GFX_HEIGHT) * GFX_WIDTH;
+                        if (gfx[index] == 1) {
                             V[0xF] = 1;
                         }
-                        gfx[x + xline + ((y + yline) * 64)] ^= 1;
+                        gfx[index] ^= 1;
                     }
                 }
             }
@@ -329,8 +376,9 @@ void Chip8::execute_cycle() {
             switch (opcode & 0x00FF) {
                 // Skip next instruction if key with the value of Vx is pressed
                 case OpcodeEx9E:
-                    fmt::print("Current Instruction: SKP Vx\n");
-                    if (keypad[Vx] != 0) {
+                    TRACE("Current Instruction: SKP Vx\n");
+                    keyReadMask |= 1 << (Vx & 0xF);
+                    if (keypad[Vx & 0xF] != 0) {
                         pc += 4;
                     } else {
                         pc += 2;
@@ -339,29 +387,32 @@ void Chip8::execute_cycle() {
                     // Skip next instruction if key with the value of Vx is not
                     // pressed
                 case OpcodeExA1:
-                    fmt::print("Current Instruction: SKNP Vx\n");
-                    if (keypad[Vx] == 0) {
+                    TRACE("Current Instruction: SKNP Vx\n");
+                    keyReadMask |= 1 << (Vx & 0xF);
+                    if (keypad[Vx & 0xF] == 0) {
                         pc += 4;
                     } else {
                         pc += 2;
                     }
                     break;
                 default:
-                    fmt::format("[ERROR]: Unknown opcode. Segment: 0xE000. Opcode: {}\n",
-                                opcode);
+                    // Unknown opcode. Segment E000
+                    fault = true;
+                    return;
             }
             break;
         case 0xF000:
             switch (opcode & 0x00FF) {
                 // Set Vx = delay timer value
                 case OpcodeFx07:
-                    fmt::print("Current Instruction: LD Vx, DT\n");
+                    TRACE("Current Instruction: LD Vx, DT\n");
                     Vx = delay_timer;
                     pc += 2;
                     break;
                     // Wait for a key press, store the value of the key in Vx
                 case OpcodeFx0A: {
-                    fmt::print("Current Instruction: LD Vx, K\n");
+                    TRACE("Current Instruction: LD Vx, K\n");
+                    keyReadMask = 0xFFFF;
                     bool key_pushed = false;
 
                     for (int i = 0; i < 16; i++) {
@@ -379,70 +430,72 @@ void Chip8::execute_cycle() {
                     break;
                     // Set delay timer = Vx
                 case OpcodeFx15:
-                    fmt::print("Current Instruction: LD DT, Vx\n");
+                    TRACE("Current Instruction: LD DT, Vx\n");
                     delay_timer = Vx;
                     pc += 2;
                     break;
                     // Set sound timer = Vx
                 case OpcodeFx18:
-                    fmt::print("Current Instruction: LD ST, Vx\n");
+                    TRACE("Current Instruction: LD ST, Vx\n");
                     sound_timer = Vx;
                     pc += 2;
                     break;
                     // Set I = I + Vx
                 case OpcodeFx1E:
-                    fmt::print("Current Instruction: ADD I, Vx\n");
+                    TRACE("Current Instruction: ADD I, Vx\n");
                     if (I + Vx > 0xFFF) {
                         V[0xF] = 1;
                     } else {
                         V[0xF] = 0;
                     }
-                    I += Vx;
+                    I = (I + Vx) & 0xFFF;
                     pc += 2;
                     break;
                     // Set I = location of sprite for digit Vx
                 case OpcodeFx29:
-                    fmt::print("Current Instruction: LD F, Vx\n");
+                    TRACE("Current Instruction: LD F, Vx\n");
                     I = Vx * 0x5; // 4x5 Sprite
                     pc += 2;
                     break;
                     // Store BCD representation of Vx in memory locations I, I+1,
                     // and I+2
                 case OpcodeFx33:
-                    fmt::print("Current Instruction: LD B, Vx\n");
-                    memory[I] = Vx / 100;
-                    memory[I + 1] = (Vx / 10) % 10;
-                    memory[I + 2] = Vx % 10;
+                    TRACE("Current Instruction: LD B, Vx\n");
+                    memory[I & 0xFFF] = Vx / 100;
+                    memory[(I + 1) & 0xFFF] = (Vx / 10) % 10;
+                    memory[(I + 2) & 0xFFF] = Vx % 10;
                     pc += 2;
                     break;
                     // Store registers V0 through Vx in memory starting at location
                     // I
                 case OpcodeFx55:
-                    fmt::print("Current Instruction: LD [I], Vx\n");
+                    TRACE("Current Instruction: LD [I], Vx\n");
                     for (int i = 0; i <= ((opcode & 0x0F00) >> 8); i++) {
-                        memory[I + i] = V[i];
+                        memory[(I + i) & 0xFFF] = V[i];
                     }
-                    I += ((opcode & 0x0F00) >> 8) + 1;
+                    I = (I + ((opcode & 0x0F00) >> 8) + 1) & 0xFFF;
                     pc += 2;
                     break;
                     // Read registers V0 through Vx from memory starting at location
                     // I
                 case OpcodeFx65:
-                    fmt::print("Current Instruction: LD Vx, [I]\n");
+                    TRACE("Current Instruction: LD Vx, [I]\n");
                     for (int i = 0; i <= ((opcode & 0x0F00) >> 8); i++) {
-                        V[i] = memory[I + i];
+                        V[i] = memory[(I + i) & 0xFFF];
                     }
-                    I += ((opcode & 0x0F00) >> 8) + 1;
+                    I = (I + ((opcode & 0x0F00) >> 8) + 1) & 0xFFF;
                     pc += 2;
                     break;
                 default:
-                    fmt::format("[ERROR]: Invalid instruction. Segment: F000. Opcode: {}\n",
-                                opcode);
+                    // Invalid instruction. Segment F000
+                    fault = true;
+                    return;
             }
             break;
         default:
-            fmt::format("[ERROR]: Unimplemented instruction. Invalid opcode: {}\n",
-                        opcode);
+            // Unimplemented instruction
+            fault = true;
+            return;
     }
 
     if (sound_timer > 0) {
@@ -0,0 +1,135 @@
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <type_traits>
+
+#include "../include/chip8.h"
+#include "../include/chip8_c.h"
+
+// The whole machine, RNG included, lives in one plain struct, so a snapshot is a byte copy
+static_assert(std::is_trivially_copyable_v<Chip8>, "Chip8 state must be trivially copyable");
+static_assert(std::is_standard_layout_v<Chip8>, "Snapshot validation reads fields by offset");
+static_assert(CYCLES_PER_FRAME == CHIP8_CYCLES_PER_FRAME, "C API frame length must match the core");
+static_assert(sizeof(bool) == sizeof(u8), "drawFlag and fault are exposed to C as bytes");
+
+struct chip8_t {
+    Chip8 core;
+};
+
+chip8_t *chip8_create(uint32_t seed) {
+    auto *machine = new (std::nothrow) chip8_t();
+    if (machine != nullptr) {
+        machine->core.init();
+        machine->core.seed(seed);
+    }
+    return machine;
+}
+
+void chip8_destroy(chip8_t *machine) {
+    delete machine;
+}
+
+void chip8_seed(chip8_t *machine, uint32_t seed) {
+    machine->core.seed(seed);
+}
+
+int chip8_load_rom(chip8_t *machine, const uint8_t *rom, size_t size) {
+    if (!machine->core.load_rom(rom, size)) {
+        return -1;
+    }
+    return 0;
+}
+
+int chip8_step(chip8_t *machine, int cycles) {
+    Chip8 &core = machine->core;
+
+    for (int i = 0; i < cycles && !core.fault; i++) {
+        core.execute_cycle();
+    }
+    return core.fault ? -1 : 0;
+}
+
+int chip8_step_frame(chip8_t *machine) {
+    return chip8_step(machine, CHIP8_CYCLES_PER_FRAME);
+}
+
+// Stepping many machines per call keeps the FFI crossing out of the inner loop
+size_t chip8_step_batch(chip8_t *const *machines, size_t count, int cycles) {
+    size_t faulted = 0;
+    for (size_t m = 0; m < count; m++) {
+        if (chip8_step(machines[m], cycles) != 0) {
+            faulted++;
+        }
+    }
+    return faulted;
+}
+
+size_t chip8_step_frame_batch(chip8_t *const *machines, size_t count) {
+    return chip8_step_batch(machines, count, CHIP8_CYCLES_PER_FRAME);
+}
+
+void chip8_set_keypad(chip8_t *machine, uint16_t mask) {
+    for (int i = 0; i < KEY_COUNT; i++) {
+        machine->core.keypad[i] = (mask >> i) & 1;
+    }
+}
+
+void chip8_get_view(const chip8_t *machine, chip8_view *view) {
+    const Chip8 &core = machine->core;
+
+    view->gfx = core.gfx;
+    view->V = core.V;
+    view->I = &core.I;
+    view->pc = &core.pc;
+    view->sp = &core.sp;
+    view->stack = core.stack;
+    view->delay_timer = &core.delay_timer;
+    view->sound_timer = &core.sound_timer;
+    view->memory = core.memory;
+    view->keypad = core.keypad;
+    view->draw_flag = reinterpret_cast<const uint8_t *>(&core.drawFlag);
+    view->opcode = &core.opcode;
+    view->fault = reinterpret_cast<const uint8_t *>(&core.fault);
+}
+
+void chip8_clear_draw_flag(chip8_t *machine) {
+    machine->core.drawFlag = false;
+}
+
+size_t chip8_state_size(void) {
+    return sizeof(Chip8);
+}
+
+int chip8_save_state(const chip8_t *machine, void *buffer, size_t size) {
+    if (buffer == nullptr || size < sizeof(Chip8)) {
+        return -1;
+    }
+    std::memcpy(buffer, &machine->core, sizeof(Chip8));
+    return 0;
+}
+
+// A snapshot may come from anywhere, so reject anything execute_cycle() could not
+// have produced before it can index out of bounds
+static bool valid_state(const u8 *bytes) {
+    // bool members must hold 0 or 1, check the raw bytes before they become bools
+    const size_t flags[] = {offsetof(Chip8, drawFlag), offsetof(Chip8, fault)};
+    for (size_t offset : flags) {
+        if (bytes[offset] > 1) {
+            return false;
+        }
+    }
+
+    Chip8 state;
+    std::memcpy(&state, bytes, sizeof(Chip8));
+
+    return state.pc <= SYSTEM_MEMORY - 2 && state.sp <= STACK_SIZE && state.I < SYSTEM_MEMORY &&
+           state.rng != 0;
+}
+
+int chip8_load_state(chip8_t *machine, const void *buffer, size_t size) {
+    if (buffer == nullptr || size < sizeof(Chip8) || !valid_state((const u8 *) buffer)) {
+        return -1;
+    }
+    std::memcpy(&machine->core, buffer, sizeof(Chip8));
+    return 0;
+}
@@ -0,0 +1,86 @@
+#include <algorithm>
+
+#include "../include/latency.h"
+
+#include "fmt/core.h"
+
+// Keep at most this many unpresented events, e.g. when a ROM never polls the keypad
+const size_t MAX_PENDING_EVENTS = 256;
+
+static double micros(latency_clock::duration d) {
+    return std::chrono::duration<double, std::micro>(d).count();
+}
+
+void LatencyTracker::key_event(int key, latency_clock::time_point when) {
+    if (pending.size() == MAX_PENDING_EVENTS) {
+        if (pending.front().was_read) {
+            dropped_read++;
+        } else {
+            dropped_unread++;
+        }
+        pending.erase(pending.begin());
+    }
+    Trace trace;
+    trace.key = key;
+    trace.event = when;
+    pending.push_back(trace);
+}
+
+// The first read of the event's own key is the one that can observe it
+void LatencyTracker::key_read(u16 keys, latency_clock::time_point when) {
+    for (Trace &t : pending) {
+        if (!t.was_read && (keys >> t.key & 1) && t.event <= when) {
+            t.read = when;
+            t.was_read = true;
+        }
+    }
+}
+
+void LatencyTracker::draw(latency_clock::time_point when) {
+    for (Trace &t : pending) {
+        if (t.was_read && !t.was_drawn) {
+            t.drawn = when;
+            t.was_drawn = true;
+        }
+    }
+}
+
+void LatencyTracker::present(latency_clock::time_point when) {
+    auto first_done = std::stable_partition(pending.begin(), pending.end(),
+                                            [](const Trace &t) { return !t.was_drawn; });
+
+    for (auto it = first_done; it != pending.end(); ++it) {
+        event_to_read.push_back(micros(it->read - it->event));
+        read_to_draw.push_back(micros(it->drawn - it->read));
+        draw_to_present.push_back(micros(when - it->drawn));
+        event_to_present.push_back(micros(when - it->event));
+    }
+    pending.erase(first_done, pending.end());
+}
+
+// Percentile of an already sorted list, rounded to the closest sample
+static double percentile(const std::vector<double> &sorted, double p) {
+    size_t rank = (size_t) (p / 100.0 * (sorted.size() - 1) + 0.5);
+    return sorted[rank];
+}
+
+static void report_stage(const char *name, std::vector<double> samples) {
+    std::sort(samples.begin(), samples.end());
+    fmt::print("  {:<18} p50 {:>9.1f}  p90 {:>9.1f}  p99 {:>9.1f}  max {:>9.1f}\n", name,
+               percentile(samples, 50), percentile(samples, 90), percentile(samples, 99),
+               samples.back());
+}
+
+void LatencyTracker::report() const {
+    fmt::print("Input latency over {} key events (us), {} pending, {} dropped unread, "
+               "{} dropped after read\n",
+               event_to_present.size(), pending.size(), dropped_unread, dropped_read);
+    if (event_to_present.empty()) {
+        return;
+    }
+
+    report_stage("event -> read", event_to_read);
+    report_stage("read -> draw", read_to_draw);
+    report_stage("draw -> present", draw_to_present);
+    report_stage("event -> present", event_to_present);
+}
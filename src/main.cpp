@@ -1,10 +1,13 @@
 #include "fmt/core.h"
 #include "../lib/indicators/single_include/indicators/indicators.hpp"
 #include "SDL2/SDL.h"
+#include <algorithm>
 #include <chrono>
+#include <cstring>
 #include <thread>
 
 #include "../include/chip8.h"
+#include "../include/latency.h"
 
 // Keypad keymap
 static u8 keymap[16] = {
@@ -12,6 +15,145 @@ static u8 keymap[16] = {
         SDLK_s, SDLK_d, SDLK_z, SDLK_c, SDLK_4, SDLK_r, SDLK_f, SDLK_v,
 };
 
+const auto FRAME_TIME = std::chrono::microseconds(16667); // 60Hz
+const auto LATE_INPUT_SLACK = std::chrono::milliseconds(1); // Safety margin before the frame deadline
+
+// Keypad state collected from SDL events, copied into the machine at each input sample point.
+// A key pressed since the last sample is latched down for at least one sample even if it was
+// released again, so quick taps are not lost when input is sampled once per frame.
+struct PendingInput {
+    u8 keypad[KEY_COUNT] = {};
+    u16 latched = 0;  // Keys pressed since the last sample
+    u16 deferred = 0; // Releases of latched keys, applied at the sample after next
+    u16 releasing = 0; // Deferred releases that become visible at the next sample
+    latency_clock::time_point release_time[KEY_COUNT];
+};
+
+// Process one SDL event, such as the keyboard. Returns false once the user asks to quit.
+static bool handle_event(const SDL_Event &e, PendingInput &input, LatencyTracker &latency) {
+    if (e.type == SDL_QUIT)
+        return false;
+
+    if (e.type != SDL_KEYDOWN && e.type != SDL_KEYUP)
+        return true;
+
+    // Handle escape key to terminate program
+    if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_ESCAPE)
+        return false;
+
+    // Ignore auto-repeat, the key is already down
+    if (e.key.repeat)
+        return true;
+
+    for (int i = 0; i < 16; ++i) {
+        if (e.key.keysym.sym == keymap[i]) {
+            // SDL stamps e.key.timestamp when it pumps the event, which is about now, so
+            // the event is timed when we receive it. Callers keep receiving while they wait.
+            auto now = latency_clock::now();
+            u16 bit = 1 << i;
+
+            if (e.type == SDL_KEYDOWN) {
+                input.keypad[i] = 1;
+                input.latched |= bit;
+                input.deferred &= ~bit; // The held-back release is never seen, drop it
+                latency.key_event(i, now);
+            } else {
+                input.keypad[i] = 0;
+                if (input.latched & bit) {
+                    // The ROM has not seen this press yet, trace the release once it is applied
+                    input.deferred |= bit;
+                    input.release_time[i] = now;
+                } else {
+                    latency.key_event(i, now);
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// Process every queued SDL event without waiting. Returns false once the user asks to quit.
+static bool poll_input(PendingInput &input, LatencyTracker &latency) {
+    SDL_Event e;
+    while (SDL_PollEvent(&e)) {
+        if (!handle_event(e, input, latency))
+            return false;
+    }
+    return true;
+}
+
+// Wait until the deadline while still processing events as they arrive, so time spent
+// waiting shows up in the latency report instead of hiding in the OS queue
+static bool wait_input(PendingInput &input, LatencyTracker &latency, latency_clock::time_point deadline) {
+    while (true) {
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - latency_clock::now());
+        if (remaining.count() <= 0)
+            break;
+
+        SDL_Event e;
+        if (SDL_WaitEventTimeout(&e, (int) remaining.count()) && !handle_event(e, input, latency))
+            return false;
+    }
+    std::this_thread::sleep_until(deadline); // Sub-millisecond remainder
+    return poll_input(input, latency);
+}
+
+// Input sample point: the machine sees the keypad as of now, with latched taps still down
+static void apply_input(Chip8 &chip8, PendingInput &input, LatencyTracker &latency) {
+    for (int i = 0; i < KEY_COUNT; ++i) {
+        u16 bit = 1 << i;
+
+        // Releases held back at the previous sample become visible now, trace them from
+        // when they arrived so the wait still counts
+        if ((input.releasing & bit) && !input.keypad[i]) {
+            latency.key_event(i, input.release_time[i]);
+        }
+        chip8.keypad[i] = input.keypad[i] | ((input.latched & bit) ? 1 : 0);
+    }
+
+    input.releasing = input.deferred;
+    input.deferred = 0;
+    input.latched = 0;
+}
+
+// Execute one instruction and note keypad reads and draws. Returns true if the screen changed.
+static bool run_cycle(Chip8 &chip8, LatencyTracker &latency) {
+    chip8.execute_cycle();
+
+    if (chip8.keyReadMask != 0) {
+        latency.key_read(chip8.keyReadMask, latency_clock::now());
+        chip8.keyReadMask = 0;
+    }
+    if (chip8.drawFlag) {
+        chip8.drawFlag = false;
+        latency.draw(latency_clock::now());
+        return true;
+    }
+    return false;
+}
+
+static void present(const Chip8 &chip8, SDL_Renderer *renderer, SDL_Texture *sdlTexture,
+                    LatencyTracker &latency) {
+    // Pixel buffer
+    u32 pixels[2048];
+
+    // We will then store pixels in the temporary buffer
+    for (int i = 0; i < 2048; ++i) {
+        u8 pixel = chip8.gfx[i];
+        pixels[i] = (0x00FFFFFF * pixel) | 0xFF000000;
+    }
+    // Update SDL texture with new batch of pixels
+    SDL_UpdateTexture(sdlTexture, nullptr, pixels, 64 * sizeof(Uint32));
+    // Clear the renderer
+    SDL_RenderClear(renderer);
+    // Copy updated SDL_Texture to the renderer
+    SDL_RenderCopy(renderer, sdlTexture, nullptr, nullptr);
+    // Update renderer with copied SDL_Texture
+    SDL_RenderPresent(renderer);
+
+    latency.present(latency_clock::now());
+}
+
 int main(int argc, char **argv) {
 
     using namespace indicators;
@@ -41,10 +183,12 @@ int main(int argc, char **argv) {
 /* *****************************************************************************************/
 
 // Display terminal usage
-    if (argc != 2) {
-        fmt::print("Usage: chip8 <ROM file> \n");
+    bool low_latency = argc == 3 && std::strcmp(argv[1], "--low-latency") == 0;
+    if (argc != 2 && !low_latency) {
+        fmt::print("Usage: chip8 [--low-latency] <ROM file> \n");
         return 1;
     }
+    const char *rom_path = argv[argc - 1];
 
     Chip8 chip8 = Chip8(); // Initialize Chip8
 
@@ -67,74 +211,104 @@ int main(int argc, char **argv) {
         exit(2);
     }
 
-    // We then create the renderer for the window
-    SDL_Renderer *renderer = SDL_CreateRenderer(window, -1, 0);
+    // We then create the renderer for the window. Low-latency mode paces frames off the
+    // display, so it asks for a renderer whose present waits for vertical blank.
+    SDL_Renderer *renderer = SDL_CreateRenderer(window, -1, low_latency ? SDL_RENDERER_PRESENTVSYNC : 0);
+    if (renderer == nullptr)
+        renderer = SDL_CreateRenderer(window, -1, 0);
+
+    SDL_RendererInfo renderer_info;
+    bool vsync = SDL_GetRendererInfo(renderer, &renderer_info) == 0 &&
+                 (renderer_info.flags & SDL_RENDERER_PRESENTVSYNC) != 0;
+    if (low_latency && !vsync) {
+        fmt::print(stderr, "No vsync available: --low-latency is a 60Hz batched loop not tied to the display\n");
+    }
     SDL_RenderSetLogicalSize(renderer, w, h);
 
     // Create texture that stores frame buffer
     SDL_Texture *sdlTexture = SDL_CreateTexture(
             renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, 64, 32);
 
-    // Pixel buffer
-    u32 pixels[2048];
-
-
     // Attempt to load ROM
-    if (!chip8.load_rom(argv[1]))
+    if (!chip8.load_rom(rom_path))
         return 2;
 
-    // Emulation loop
-    while (true) {
-        chip8.execute_cycle();
+    // Generate a random seed based on current time
+    chip8.seed((u32) std::chrono::system_clock::now().time_since_epoch().count());
 
-        // Process SDL events, such as the keyboard
-        SDL_Event e;
-        while (SDL_PollEvent(&e)) {
-            if (e.type == SDL_QUIT)
-                exit(EXIT_SUCCESS);
+    LatencyTracker latency;
+    PendingInput input;
 
-            // Process keydown events
-            if (e.type == SDL_KEYDOWN) {
-                // Handle escape key to terminate program
-                if (e.key.keysym.sym == SDLK_ESCAPE)
-                    exit(EXIT_SUCCESS);
-
-                for (int i = 0; i < 16; ++i) {
-                    if (e.key.keysym.sym == keymap[i]) {
-                        chip8.keypad[i] = 1;
-                    }
-                }
+    if (low_latency) {
+        // Low-latency mode: wait through most of the frame (still receiving input), then
+        // sample input, emulate the whole frame and present it straight away, so input is as
+        // fresh as possible. With vsync each present returns at vertical blank, and the next
+        // frame is timed from there; this assumes a 60Hz display, on faster displays the frame
+        // lands on the next refresh after the deadline. Without vsync frame_start is only an
+        // internal 60Hz timer.
+        auto frame_start = latency_clock::now();
+        latency_clock::duration work_estimate = LATE_INPUT_SLACK;
+        bool running = true;
+
+        while (running && !chip8.fault) {
+            running = wait_input(input, latency, frame_start + FRAME_TIME - work_estimate);
+
+            auto work_start = latency_clock::now();
+            apply_input(chip8, input, latency);
+
+            bool dirty = false;
+            for (int i = 0; i < CYCLES_PER_FRAME; ++i) {
+                dirty |= run_cycle(chip8, latency);
             }
-            // Process keyup events
-            if (e.type == SDL_KEYUP) {
-                for (int i = 0; i < 16; ++i) {
-                    if (e.key.keysym.sym == keymap[i]) {
-                        chip8.keypad[i] = 0;
-                    }
+
+            // Track the slowest recent frame so the late input sample does not miss the deadline.
+            // A vsynced present blocks until vertical blank, so it is not counted as work.
+            auto work = latency_clock::now() - work_start;
+
+            if (vsync) {
+                // Present every frame so the loop stays locked to the display
+                present(chip8, renderer, sdlTexture, latency);
+                frame_start = latency_clock::now();
+            } else {
+                if (dirty) {
+                    present(chip8, renderer, sdlTexture, latency);
+                }
+                work = latency_clock::now() - work_start;
+
+                frame_start += FRAME_TIME;
+                if (latency_clock::now() > frame_start + FRAME_TIME) {
+                    frame_start = latency_clock::now(); // Fell behind, do not try to catch up
                 }
             }
-        }
 
-        // If draw occurred, redraw SDL screen
-        if (chip8.drawFlag) {
-            chip8.drawFlag = false;
+            work_estimate = std::max<latency_clock::duration>(work + LATE_INPUT_SLACK,
+                                                              work_estimate * 15 / 16);
+        }
+    } else {
+        // Emulation loop
+        while (!chip8.fault && poll_input(input, latency)) {
+            apply_input(chip8, input, latency);
 
-            // We will then store pixels in the temporary buffer
-            for (int i = 0; i < 2048; ++i) {
-                u8 pixel = chip8.gfx[i];
-                pixels[i] = (0x00FFFFFF * pixel) | 0xFF000000;
+            // If draw occurred, redraw SDL screen
+            if (run_cycle(chip8, latency)) {
+                present(chip8, renderer, sdlTexture, latency);
             }
-            // Update SDL texture with new batch of pixels
-            SDL_UpdateTexture(sdlTexture, nullptr, pixels, 64 * sizeof(Uint32));
-            // Clear the renderer
-            SDL_RenderClear(renderer);
-            // Copy updated SDL_Texture to the renderer
-            SDL_RenderCopy(renderer, sdlTexture, nullptr, nullptr);
-            // Update renderer with copied SDL_Texture
-            SDL_RenderPresent(renderer);
+
+            // Slow down the running thread to pace the emulation
+            std::this_thread::sleep_for(std::chrono::microseconds(1300));
         }
+    }
 
-        // Slow down the running thread to pace the emulation
-        std::this_thread::sleep_for(std::chrono::microseconds(1300));
+    latency.report();
+
+    if (chip8.fault) {
+        fmt::print(stderr, "[ERROR]: Invalid opcode or machine state at PC {:#05x}. Opcode: {:#06x}\n",
+                   chip8.pc, chip8.opcode);
     }
+
+    SDL_DestroyTexture(sdlTexture);
+    SDL_DestroyRenderer(renderer);
+    SDL_DestroyWindow(window);
+    SDL_Quit();
+    return chip8.fault ? EXIT_FAILURE : EXIT_SUCCESS;
 }
@@ -8,29 +8,47 @@
 const u16 MEMORY_START = 512;
 
 bool Chip8::load_rom(const char *rom_path) {
-    // Initialize
-    init();
-
     std::ifstream infile(rom_path, std::ios::binary | std::ios::ate); // Read ROM starting at end and in binary mode
 
     // Check to see if successful
     if (!infile.good()) {
-        fmt::format("Error! Could not read file: {} ", rom_path);
+        fmt::print(stderr, "Error! Could not read file: {}\n", rom_path);
         return false;
     } else {
         std::streampos size = infile.tellg(); // Get ROM size
+        if (size < 0) {
+            fmt::print(stderr, "Error! Could not read file: {}\n", rom_path);
+            return false;
+        }
         char *buffer = new char[size];
 
         infile.seekg(0, std::ios::beg); // Move read position to beginning of ROM
         infile.read(buffer, size);
         infile.close();
 
-        for (long i = 0; i < size; i++) {
-            memory[i + MEMORY_START] = (u8) buffer[i]; // Chip-8 memory starts at 512 bytes
+        bool loaded = load_rom((const u8 *) buffer, (size_t) size);
+        if (!loaded) {
+            fmt::print(stderr, "Error! ROM size {} does not fit in memory\n", (size_t) size);
         }
 
         delete[] buffer;
+        return loaded;
+    }
+}
+
+// Load ROM that is already in memory (used by the C API). Does not print; on
+// failure the machine is left untouched and the caller reports the error.
+bool Chip8::load_rom(const u8 *rom_data, size_t size) {
+    // Check to see if ROM fits in program memory
+    if (rom_data == nullptr || size > (size_t) (SYSTEM_MEMORY - MEMORY_START)) {
+        return false;
     }
-    return true;
 
+    // Initialize
+    init();
+
+    for (size_t i = 0; i < size; i++) {
+        memory[i + MEMORY_START] = rom_data[i]; // Chip-8 memory starts at 512 bytes
+    }
+    return true;
 }